@@ -0,0 +1,274 @@
+// bench.c
+// Tawfeeq Mannan
+
+// library includes
+#define _GNU_SOURCE  // strsep only defined in glibc
+#include <stdio.h>      // printf, fopen, ...
+#include <stdlib.h>     // malloc, free
+#include <string.h>     // strsep, strlen, memcpy
+#include <stdint.h>     // uint64_t
+#include <time.h>       // clock_gettime
+
+// user includes
+#include "mapreduce.h"
+#include "tokenizer.h"
+
+#define DELIMS " \t\n\r"
+#define KERNEL_REPS 50
+#define RUN_FILES 2     // MR_Run's sorted inserts are quadratic, keep it short
+#define LONG_KEY_LEN 256 // long enough for MR_Hash's 4-lane path
+
+
+/**
+ * @brief Get the current time of the monotonic clock
+ *
+ * @return Time in seconds
+ */
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+
+/**
+ * @brief Read a whole file into a newly allocated buffer
+ *
+ * @param file_name file to read
+ * @param len output no. bytes read
+ *
+ * @return The buffer (caller must free), or NULL on failure
+ */
+static char *read_file(const char *file_name, size_t *len)
+{
+    FILE *fp = fopen(file_name, "r");
+    if (fp == NULL) return NULL;
+    fseek(fp, 0, SEEK_END);
+    long size = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    char *buf = malloc(size + 1);
+    *len = fread(buf, 1, size, fp);
+    buf[*len] = '\0';
+    fclose(fp);
+    return buf;
+}
+
+
+/**
+ * @brief The pre-tokenizer hot path: strsep, then DJB2 and two strlen calls
+ * per token, as MR_Emit used to do
+ *
+ * @param buf null-terminated buffer, clobbered by strsep
+ *
+ * @return Checksum so the work can't be optimized away
+ */
+static uint64_t kernel_strsep_djb2(char *buf)
+{
+    uint64_t sum = 0;
+    char *token, *dummy = buf;
+    while ((token = strsep(&dummy, DELIMS)) != NULL)
+    {
+        unsigned long hash = 5381;
+        for (char *c = token; *c != '\0'; c++)
+            hash = hash * 33 + *c;
+        sum += hash % 10 + strlen(token) + strlen("1");
+    }
+    return sum;
+}
+
+
+/**
+ * @brief The Tokenizer hot path: token views hashed once with MR_Hash
+ *
+ * @param buf buffer to split
+ * @param len no. bytes in the buffer
+ *
+ * @return Checksum so the work can't be optimized away
+ */
+static uint64_t kernel_tokenizer_hash(const char *buf, size_t len)
+{
+    uint64_t sum = 0;
+    Tokenizer_t tk;
+    Token_t token;
+    Tokenizer_init(&tk, buf, len, DELIMS);
+    while (Tokenizer_next(&tk, &token))
+        sum += MR_Hash(token.start, token.len) % 10 + token.len + 1;
+    return sum;
+}
+
+
+/**
+ * @brief MR_Hash without the lanes: one serial rotate/xor/multiply chain over
+ * the whole key, as used before keys of 32+ bytes were split
+ *
+ * @param key start of the key
+ * @param len no. bytes in the key, a multiple of 8
+ *
+ * @return 64-bit hash of the key
+ */
+__attribute__((noinline))
+static uint64_t hash_serial(const char *key, size_t len)
+{
+    const uint64_t seed = 0x51d7348d3c5d1f45ULL;
+    uint64_t hash = len * 0x9e3779b97f4a7c15ULL, word;
+    for (; len >= 8; key += 8, len -= 8)
+    {
+        memcpy(&word, key, 8);
+        hash = (((hash << 5) | (hash >> 59)) ^ word) * seed;
+    }
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdULL;
+    hash ^= hash >> 33;
+    hash *= 0xc4ceb9fe1a85ec53ULL;
+    hash ^= hash >> 33;
+    return hash;
+}
+
+
+/**
+ * @brief Hash every key_len-byte slice of a buffer with the serial chain
+ *
+ * @param buf buffer to hash
+ * @param len no. bytes in the buffer
+ * @param key_len no. bytes per key
+ *
+ * @return Checksum so the work can't be optimized away
+ */
+static uint64_t kernel_long_serial(const char *buf, size_t len, size_t key_len)
+{
+    uint64_t sum = 0;
+    for (size_t off = 0; off + key_len <= len; off += key_len)
+        sum += hash_serial(buf + off, key_len);
+    return sum;
+}
+
+
+/**
+ * @brief Hash every key_len-byte slice of a buffer with MR_Hash
+ *
+ * @param buf buffer to hash
+ * @param len no. bytes in the buffer
+ * @param key_len no. bytes per key
+ *
+ * @return Checksum so the work can't be optimized away
+ */
+static uint64_t kernel_long_hash(const char *buf, size_t len, size_t key_len)
+{
+    uint64_t sum = 0;
+    for (size_t off = 0; off + key_len <= len; off += key_len)
+        sum += MR_Hash(buf + off, key_len);
+    return sum;
+}
+
+
+void Map_strsep(char *file_name)
+{
+    size_t len;
+    char *buf = read_file(file_name, &len);
+    if (buf == NULL) return;
+    char *token, *dummy = buf;
+    while ((token = strsep(&dummy, DELIMS)) != NULL)
+        MR_Emit(token, "1");
+    free(buf);
+}
+
+
+void Map_tokenizer(char *file_name)
+{
+    size_t len;
+    char *buf = read_file(file_name, &len);
+    if (buf == NULL) return;
+    Tokenizer_t tk;
+    Token_t token;
+    Tokenizer_init(&tk, buf, len, DELIMS);
+    while (Tokenizer_next(&tk, &token))
+        MR_EmitToken(token.start, token.len, "1", 1);
+    free(buf);
+}
+
+
+void Reduce_count(char *key, unsigned int partition_idx)
+{
+    char *value;
+    while ((value = MR_GetNext(key, partition_idx)) != NULL)
+        free(value);
+}
+
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2)
+    {
+        printf("Usage: %s FILE...\n", argv[0]);
+        return 1;
+    }
+
+    // concatenate every input into one buffer for the kernel benchmarks
+    size_t total = 0;
+    char *corpus = NULL;
+    for (int i = 1; i < argc; i++)
+    {
+        size_t len;
+        char *buf = read_file(argv[i], &len);
+        if (buf == NULL) { printf("Cannot read %s\n", argv[i]); return 1; }
+        corpus = realloc(corpus, total + len + 2);
+        memcpy(corpus + total, buf, len);
+        total += len;
+        corpus[total++] = '\n';
+        free(buf);
+    }
+    corpus[total] = '\0';
+    char *scratch = malloc(total + 1);
+
+    double start, t_old = 0, t_new = 0;
+    uint64_t sum_old = 0, sum_new = 0;
+    for (int rep = 0; rep < KERNEL_REPS; rep++)
+    {
+        memcpy(scratch, corpus, total + 1);  // strsep clobbers its input
+        start = now();
+        sum_old += kernel_strsep_djb2(scratch);
+        t_old += now() - start;
+
+        start = now();
+        sum_new += kernel_tokenizer_hash(corpus, total);
+        t_new += now() - start;
+    }
+    double mb = (double) total * KERNEL_REPS / (1 << 20);
+    printf("kernel   strsep+djb2     %8.1f MB/s  (checksum %llu)\n",
+           mb / t_old, (unsigned long long) sum_old);
+    printf("kernel   tokenizer+hash  %8.1f MB/s  (checksum %llu)\n",
+           mb / t_new, (unsigned long long) sum_new);
+
+    // long keys, where MR_Hash splits the key across lanes
+    t_old = t_new = 0;
+    sum_old = sum_new = 0;
+    for (int rep = 0; rep < KERNEL_REPS; rep++)
+    {
+        start = now();
+        sum_old += kernel_long_serial(corpus, total, LONG_KEY_LEN);
+        t_old += now() - start;
+
+        start = now();
+        sum_new += kernel_long_hash(corpus, total, LONG_KEY_LEN);
+        t_new += now() - start;
+    }
+    printf("kernel   %dB keys serial  %8.1f MB/s  (checksum %llu)\n",
+           LONG_KEY_LEN, mb / t_old, (unsigned long long) sum_old);
+    printf("kernel   %dB keys MR_Hash %8.1f MB/s  (checksum %llu)\n",
+           LONG_KEY_LEN, mb / t_new, (unsigned long long) sum_new);
+
+    // end-to-end runs through the whole framework
+    unsigned int run_files = argc - 1 < RUN_FILES ? argc - 1 : RUN_FILES;
+    start = now();
+    MR_Run(run_files, &argv[1], Map_strsep, Reduce_count, 5, 10);
+    printf("MR_Run   strsep+MR_Emit  %8.3f s\n", now() - start);
+
+    start = now();
+    MR_Run(run_files, &argv[1], Map_tokenizer, Reduce_count, 5, 10);
+    printf("MR_Run   MR_EmitToken    %8.3f s\n", now() - start);
+
+    free(scratch);
+    free(corpus);
+    return 0;
+}
@@ -0,0 +1,92 @@
+// chainwc.c
+// Tawfeeq Mannan
+
+// library includes
+#define _GNU_SOURCE  // getline only defined in glibc
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// user includes
+#include "mapreduce.h"
+#include "tokenizer.h"
+
+
+// stage 1: count each word, like wordcount
+void Map(char *file_name)
+{
+    FILE *fp = fopen(file_name, "r");
+    assert(fp != NULL);
+
+    char *line = NULL;
+    size_t size = 0;
+    ssize_t len;
+    Tokenizer_t tk;
+    Token_t token;
+    Tokenizer_init(&tk, NULL, 0, " \t\n\r");
+    while ((len = getline(&line, &size, fp)) != -1)
+    {
+        Tokenizer_reset(&tk, line, len);
+        while (Tokenizer_next(&tk, &token))
+        {
+            if (token.len > 0)
+                MR_EmitToken(token.start, token.len, "1", 1);
+        }
+    }
+    free(line);
+    fclose(fp);
+}
+
+
+void Reduce(char *key, unsigned int partition_idx)
+{
+    int count = 0;
+    char *value, count_str[16];
+    while ((value = MR_GetNext(key, partition_idx)) != NULL)
+    {
+        count++;
+        free(value);
+    }
+    sprintf(count_str, "%d", count);
+    MR_EmitOutput(key, count_str, partition_idx);
+}
+
+
+// stage 2: histogram of how many distinct words share each count
+void HistMap(unsigned int input_idx)
+{
+    char *word, *count;
+    while (MR_GetInput(input_idx, &word, &count))
+    {
+        MR_Emit(count, "1");
+        free(word);
+        free(count);
+    }
+}
+
+
+void HistReduce(char *key, unsigned int partition_idx)
+{
+    int num_words = 0;
+    char *value, name[100];
+    while ((value = MR_GetNext(key, partition_idx)) != NULL)
+    {
+        num_words++;
+        free(value);
+    }
+    sprintf(name, "result-%d.txt", partition_idx);
+    FILE *fp = fopen(name, "a");
+    fprintf(fp, "%s: %d\n", key, num_words);
+    fclose(fp);
+}
+
+
+int main(int argc, char *argv[])
+{
+    MR_Stage_t stages[] = {
+        { HistMap, HistReduce, 4 },
+    };
+    MR_RunChain(argc - 1, &(argv[1]), Map, Reduce, 5, 10, stages, 1);
+    return 0;
+}
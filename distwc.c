@@ -2,7 +2,7 @@
 // Tawfeeq Mannan
 
 // library includes
-#define _GNU_SOURCE  // getline and strsep only defined in glibc
+#define _GNU_SOURCE  // getline only defined in glibc
 #include <assert.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -10,6 +10,7 @@
 
 // user includes
 #include "mapreduce.h"
+#include "tokenizer.h"
 
 
 void Map(char *file_name)
@@ -19,12 +20,16 @@ void Map(char *file_name)
 
     char *line = NULL;
     size_t size = 0;
-    while (getline(&line, &size, fp) != -1)
+    ssize_t len;
+    Tokenizer_t tk;
+    Token_t token;
+    Tokenizer_init(&tk, NULL, 0, " \t\n\r");
+    while ((len = getline(&line, &size, fp)) != -1)
     {
-        char *token, *dummy = line;
-        while ((token = strsep(&dummy, " \t\n\r")) != NULL)
+        Tokenizer_reset(&tk, line, len);
+        while (Tokenizer_next(&tk, &token))
         {
-            MR_Emit(token, "1");
+            MR_EmitToken(token.start, token.len, "1", 1);
         }
     }
     free(line);
@@ -5,8 +5,14 @@
 #define _GNU_SOURCE
 #include <stdio.h>      // printf
 #include <stdlib.h>     // malloc, free, qsort
-#include <string.h>     // strcmp, strdup, strlen
+#include <string.h>     // strcmp, strdup, strlen, memcpy
 #include <stdbool.h>    // true/false
+#include <stdint.h>     // uint64_t
+#include <signal.h>     // sig_atomic_t
+#include <time.h>       // clock_gettime, nanosleep
+#include <fcntl.h>      // open
+#include <unistd.h>     // read, close
+#include <errno.h>      // errno
 #include <sys/stat.h>   // stat
 #include <pthread.h>    // pthread_mutex_t, etc...
 
@@ -19,6 +25,8 @@ typedef struct pair_t
 {
     char *key;                  // key to index by
     char *value;                // value associated with a key
+    size_t key_len;             // strlen of key, cached for size accounting
+    size_t value_len;           // strlen of value, cached likewise
     struct pair_t *next;        // pointer to next item in linked list
 } pair_t;
 
@@ -32,11 +40,106 @@ typedef struct partition_t
 } partition_t;
 
 
+typedef struct output_t
+{
+    pair_t *head;               // reduce outputs in the order they were made
+    pair_t *tail;               // last output, for O(1) appends
+} output_t;
+
+
+typedef struct task_t
+{
+    struct stage_t *stage;      // stage this map or reduce job belongs to
+    unsigned int idx;           // input or partition index this job handles
+    char *file_name;            // input file (first stage's map jobs only)
+} task_t;
+
+
+typedef struct state_t
+{
+    char *key;                  // key this state belongs to
+    size_t key_len;             // strlen of key
+    uint64_t hash;              // MR_Hash of key, reused when rehashing
+    char **panes;               // combined value per pane, NULL if none yet
+    struct state_t *next;       // next state in the same hash bucket
+} state_t;
+
+
+typedef struct table_t
+{
+    state_t **buckets;          // hash buckets, a power of 2 of them
+    unsigned int num_buckets;   // no. buckets
+    unsigned int num_keys;      // no. states across all buckets
+    pthread_mutex_t lock;       // lock to protect concurrent writes
+} table_t;
+
+
+typedef struct stream_t
+{
+    StreamMapper mapper;        // map function, run once per record
+    Combiner combiner;          // folds a value into a key's pane state
+    WindowReducer reducer;      // reduce function, run once per key per window
+    unsigned int num_panes;     // no. panes (slides) per window
+    unsigned int pane;          // ring index of the pane being written to
+    MR_Window_t window;         // window currently being closed
+    table_t *tables;            // one table of per-key state per partition
+} stream_t;
+
+
+typedef struct source_t
+{
+    char *name;                 // file or FIFO name
+    int fd;                     // non-blocking file descriptor
+    char *buf;                  // bytes read that don't yet end in a newline
+    size_t len;                 // no. bytes in buf
+    size_t cap;                 // no. bytes allocated for buf
+    bool skipping;              // flag set while dropping an overlong line
+} source_t;
+
+
+typedef struct chunk_t
+{
+    struct stage_t *stage;      // stage the chunk is mapped in
+    char *data;                 // whole lines, each ending in a newline
+    size_t len;                 // no. bytes in data
+} chunk_t;
+
+
+typedef struct stage_t
+{
+    Mapper file_mapper;         // map function of the first stage, else NULL
+    StageMapper mapper;         // map function of every later stage
+    Reducer reducer;            // reduce function
+    unsigned int num_partitions;    // no. of intermediate partitions
+    partition_t *partitions;    // array of intermediate partitions
+    output_t *inputs;           // upstream stage's outputs, or NULL if first
+    output_t *outputs;          // reduce outputs, or NULL if last stage
+    struct stage_t *next;       // downstream stage, or NULL if last stage
+    task_t *map_tasks;          // args for each map job
+    task_t *reduce_tasks;       // args for each reduce job
+    unsigned int pending_maps;  // no. map jobs that have yet to finish
+    unsigned int *sealed;       // partition indices, in the order reduced
+    unsigned int num_sealed;    // no. partitions fully reduced so far
+    pthread_mutex_t lock;       // lock to protect pending_maps and sealed
+    pthread_cond_t maps_done;   // condition var for pending_maps hitting 0
+    pthread_cond_t part_sealed; // condition var for num_sealed increasing
+    stream_t *stream;           // streaming state, or NULL for batch stages
+} stage_t;
+
+
+#define STREAM_READ_SIZE 65536      // max bytes read from a source at once
+#define STREAM_MAX_RECORD 1048576   // default max bytes per record
+#define STREAM_INIT_BUCKETS 64      // initial # of buckets per state table
+
+
 // global vars (shared data)
-unsigned int num_partitions;    // no. of partitions (needed by MR_Emit)
 ThreadPool_t *threadpool;       // worker thread pool
-partition_t *partitions;        // array of partitions
-Reducer global_reducer;         // reducer function (needed by MR_Reduce)
+// stage whose map or reduce job this thread is running (needed by MR_Emit)
+static _Thread_local stage_t *current_stage;
+// stage of a running single-stage job, for threads outside the pool
+static stage_t *only_stage;
+// flag to signal a running stream should close its last window and return
+static volatile sig_atomic_t stream_stop;
 
 
 /**
@@ -56,16 +159,354 @@ int compare_mapper_files(const char *file1, const char *file2)
 
 
 /**
- * @brief Comparison function for the reducer partition indices, based on size
+ * @brief Comparison function for reduce jobs, based on their partition size
  * 
- * @param idx1 Pointer to 1st partition index
- * @param idx2 Pointer to 2nd partition index
+ * @param task1 Pointer to 1st reduce job's args
+ * @param task2 Pointer to 2nd reduce job's args
  * @return int -1 if LHS<RHS, 1 if LHS>RHS, 0 if equal
  */
-int compare_partitions(const unsigned int *idx1, const unsigned int *idx2)
+int compare_partitions(const task_t *task1, const task_t *task2)
+{
+    unsigned int size1 = task1->stage->partitions[task1->idx].size;
+    unsigned int size2 = task2->stage->partitions[task2->idx].size;
+    return (size1 > size2) - (size1 < size2);
+}
+
+
+/**
+ * @brief Set up a stage's partitions, outputs and job args
+ * 
+ * @param stage pointer to the stage to initialize
+ * @param num_maps # of map jobs the stage will run
+ * @param has_next whether a downstream stage consumes this one's outputs
+ */
+static void stage_init(stage_t *stage, unsigned int num_maps, bool has_next)
+{
+    stage->partitions = malloc(sizeof(partition_t) * stage->num_partitions);
+    stage->reduce_tasks = malloc(sizeof(task_t) * stage->num_partitions);
+    for (unsigned int i = 0; i < stage->num_partitions; i++)
+    {
+        stage->partitions[i].size = 0;
+        stage->partitions[i].head = NULL;
+        pthread_mutex_init(&stage->partitions[i].lock, NULL);
+        stage->reduce_tasks[i].stage = stage;
+        stage->reduce_tasks[i].idx = i;
+        stage->reduce_tasks[i].file_name = NULL;
+    }
+
+    stage->outputs = NULL;
+    if (has_next)
+    {
+        stage->outputs = malloc(sizeof(output_t) * stage->num_partitions);
+        for (unsigned int i = 0; i < stage->num_partitions; i++)
+            stage->outputs[i].head = stage->outputs[i].tail = NULL;
+    }
+
+    stage->map_tasks = malloc(sizeof(task_t) * num_maps);
+    for (unsigned int i = 0; i < num_maps; i++)
+    {
+        stage->map_tasks[i].stage = stage;
+        stage->map_tasks[i].idx = i;
+        stage->map_tasks[i].file_name = NULL;
+    }
+    stage->pending_maps = num_maps;
+    stage->sealed = malloc(sizeof(unsigned int) * stage->num_partitions);
+    stage->num_sealed = 0;
+    stage->stream = NULL;
+    pthread_mutex_init(&stage->lock, NULL);
+    pthread_cond_init(&stage->maps_done, NULL);
+    pthread_cond_init(&stage->part_sealed, NULL);
+}
+
+
+/**
+ * @brief Free a stage's partitions, outputs and job args
+ * 
+ * Any outputs left unread by the downstream mapper are freed here too.
+ * 
+ * @param stage pointer to the stage to destroy
+ */
+static void stage_destroy(stage_t *stage)
 {
-    return (partitions[*idx1].size > partitions[*idx2].size)
-            - (partitions[*idx1].size < partitions[*idx2].size);
+    for (unsigned int i = 0; i < stage->num_partitions; i++)
+        pthread_mutex_destroy(&stage->partitions[i].lock);
+    if (stage->outputs != NULL)
+    {
+        for (unsigned int i = 0; i < stage->num_partitions; i++)
+        {
+            pair_t *curr = stage->outputs[i].head;
+            while (curr != NULL)
+            {
+                pair_t *next = curr->next;
+                free(curr->key);
+                free(curr->value);
+                free(curr);
+                curr = next;
+            }
+        }
+    }
+    pthread_cond_destroy(&stage->maps_done);
+    pthread_cond_destroy(&stage->part_sealed);
+    pthread_mutex_destroy(&stage->lock);
+    free(stage->partitions);
+    free(stage->outputs);
+    free(stage->map_tasks);
+    free(stage->reduce_tasks);
+    free(stage->sealed);
+}
+
+
+/**
+ * @brief Get the stage the calling thread is emitting to or reading from
+ * 
+ * Pool threads use the stage of the job they are running. Other threads
+ * (e.g. helpers spawned by a mapper) fall back to the running job's only
+ * stage, since with several stages there is no telling which one they
+ * belong to.
+ * 
+ * @param caller name of the public function asking, for the error message
+ * 
+ * @return Pointer to the stage, or NULL if there is none
+ */
+static stage_t *caller_stage(const char *caller)
+{
+    if (current_stage != NULL) return current_stage;
+    if (only_stage == NULL)
+        printf("%s called outside a map or reduce job\n", caller);
+    return only_stage;
+}
+
+
+/**
+ * @brief Get the time elapsed on the monotonic clock
+ * 
+ * @return Time in milliseconds
+ */
+static unsigned long now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000UL + ts.tv_nsec / 1000000UL;
+}
+
+
+/**
+ * @brief Double the no. buckets of a state table, reusing the cached hashes
+ * 
+ * Caller must hold the table lock.
+ * 
+ * @param table pointer to the table to grow
+ */
+static void table_grow(table_t *table)
+{
+    unsigned int num_buckets = table->num_buckets * 2;
+    state_t **buckets = calloc(num_buckets, sizeof(state_t *));
+    for (unsigned int b = 0; b < table->num_buckets; b++)
+    {
+        state_t *curr = table->buckets[b];
+        while (curr != NULL)
+        {
+            state_t *next = curr->next;
+            unsigned int idx = (curr->hash >> 32) & (num_buckets - 1);
+            curr->next = buckets[idx];
+            buckets[idx] = curr;
+            curr = next;
+        }
+    }
+    free(table->buckets);
+    table->buckets = buckets;
+    table->num_buckets = num_buckets;
+}
+
+
+/**
+ * @brief Fold a map output into its key's state for the current pane
+ * 
+ * Takes ownership of the pair: its key becomes the state's key if this is
+ * a new key, and everything else is freed.
+ * 
+ * @param stage pointer to the streaming stage
+ * @param pair the map output, with null-terminated key and value
+ * @param hash MR_Hash of the key
+ */
+static void stream_emit(stage_t *stage, pair_t *pair, uint64_t hash)
+{
+    stream_t *stream = stage->stream;
+    table_t *table = &stream->tables[hash % stage->num_partitions];
+    pthread_mutex_lock(&table->lock);
+    // the low bits picked the partition, so index buckets by the high bits
+    unsigned int idx = (hash >> 32) & (table->num_buckets - 1);
+    state_t *state = table->buckets[idx];
+    while (state != NULL
+           && (state->hash != hash || state->key_len != pair->key_len
+               || memcmp(state->key, pair->key, pair->key_len) != 0))
+        state = state->next;
+
+    if (state == NULL)
+    {
+        // first time seeing this key (since it was last evicted)
+        state = malloc(sizeof(state_t));
+        state->key = pair->key;
+        state->key_len = pair->key_len;
+        state->hash = hash;
+        state->panes = calloc(stream->num_panes, sizeof(char *));
+        state->next = table->buckets[idx];
+        table->buckets[idx] = state;
+        pair->key = NULL;
+        if (++table->num_keys > table->num_buckets)
+            table_grow(table);
+    }
+
+    char **acc = &state->panes[stream->pane];
+    if (*acc == NULL)
+    {
+        *acc = pair->value;  // first value in this pane is the state as-is
+    }
+    else
+    {
+        // the combiner always returns a fresh string, never *acc itself,
+        // since *acc was allocated to fit its current contents exactly
+        char *combined = stream->combiner(state->key, *acc, pair->value);
+        if (combined != NULL)
+        {
+            free(*acc);
+            *acc = combined;
+        }
+        free(pair->value);
+    }
+    pthread_mutex_unlock(&table->lock);
+
+    free(pair->key);
+    free(pair);
+}
+
+
+/**
+ * @brief Queue the first bytes of a source's buffer as a map job
+ * 
+ * @param stage pointer to the streaming stage
+ * @param src pointer to the source whose buffer is handed off
+ * @param len no. bytes to hand off, ending with a newline
+ * @param max_inflight max # of map jobs allowed to be queued or running
+ */
+static void stream_submit(stage_t *stage, source_t *src, size_t len,
+                          unsigned int max_inflight)
+{
+    chunk_t *chunk = malloc(sizeof(chunk_t));
+    chunk->stage = stage;
+    chunk->len = len;
+    chunk->data = malloc(len);
+    memcpy(chunk->data, src->buf, len);
+    src->len -= len;
+    memmove(src->buf, src->buf + len, src->len);
+
+    // bound the memory held by queued chunks if mappers fall behind
+    pthread_mutex_lock(&stage->lock);
+    while (stage->pending_maps >= max_inflight)
+        pthread_cond_wait(&stage->maps_done, &stage->lock);
+    stage->pending_maps++;
+    pthread_mutex_unlock(&stage->lock);
+    ThreadPool_add_job(threadpool, MR_MapStream, chunk);
+}
+
+
+/**
+ * @brief Read the next block available from a source, and queue the
+ * complete lines read so far as a map job
+ * 
+ * Reads at most one block per call, so the master can round-robin between
+ * sources and keep closing windows on time while catching up on a backlog.
+ * A read never brings a partial line past max_record bytes, so no record
+ * handed to the mapper is longer than that. A line that would be is dropped
+ * up to its newline instead, so a source that never sends a newline can't
+ * grow the buffer without limit. A source that fails to read is closed.
+ * 
+ * @param stage pointer to the streaming stage
+ * @param src pointer to the source to poll
+ * @param max_inflight max # of map jobs allowed to be queued or running
+ * @param max_record max # of bytes in one record, excluding its newline
+ * 
+ * @return True if any new bytes were read, otherwise false
+ */
+static bool stream_poll(stage_t *stage, source_t *src,
+                        unsigned int max_inflight, size_t max_record)
+{
+    if (src->fd == -1)
+        return false;
+
+    // read no further than the end of the longest line that could still fit,
+    // keeping 1 spare byte so a partial line can always be newline-terminated
+    size_t want = max_record + 1 - src->len;
+    if (want > STREAM_READ_SIZE) want = STREAM_READ_SIZE;
+    if (src->cap - src->len <= want)
+    {
+        src->cap = src->len + want + 1;
+        src->buf = realloc(src->buf, src->cap);
+    }
+    ssize_t n = read(src->fd, src->buf + src->len, want);
+    if (n == -1 && errno != EAGAIN && errno != EWOULDBLOCK)
+    {
+        printf("Cannot read %s\n", src->name);
+        close(src->fd);
+        src->fd = -1;
+        return false;
+    }
+    if (n <= 0)
+        return false;  // at EOF, no writer, or EAGAIN; try again next poll
+    src->len += n;
+
+    // finish dropping an overlong line, up to and including its newline
+    if (src->skipping)
+    {
+        char *end = memchr(src->buf, '\n', src->len);
+        size_t skip = end != NULL ? (size_t) (end - src->buf) + 1 : src->len;
+        src->len -= skip;
+        memmove(src->buf, src->buf + skip, src->len);
+        src->skipping = end == NULL;
+    }
+
+    // hand off every complete line, keep any partial line for later
+    char *last = memrchr(src->buf, '\n', src->len);
+    if (last != NULL)
+        stream_submit(stage, src, last - src->buf + 1, max_inflight);
+
+    // the partial line can no longer fit, so drop it rather than split it
+    if (src->len > max_record)
+    {
+        printf("Dropping a line longer than %zu bytes from %s\n",
+               max_record, src->name);
+        src->len = 0;
+        src->skipping = true;
+    }
+    return true;
+}
+
+
+/**
+ * @brief Reduce the window ending now in every partition, then advance to
+ * the next pane
+ * 
+ * @param stage pointer to the streaming stage
+ * @param end_ms end of the window, in ms since the stream started
+ * @param window_ms length of each window
+ */
+static void stream_close_window(stage_t *stage, unsigned long end_ms,
+                                unsigned long window_ms)
+{
+    stream_t *stream = stage->stream;
+
+    // nothing else is queued while the master is here, so once the pool is
+    // idle every record read so far has been folded in
+    ThreadPool_check(threadpool);
+    stream->window.end_ms = end_ms;
+    stream->window.start_ms = end_ms > window_ms ? end_ms - window_ms : 0;
+    for (unsigned int i = 0; i < stage->num_partitions; i++)
+    {
+        ThreadPool_add_job(threadpool, MR_ReduceWindow,
+                           &stage->reduce_tasks[i]);
+    }
+    ThreadPool_check(threadpool);
+    stream->pane = (stream->pane + 1) % stream->num_panes;
 }
 
 
@@ -85,20 +526,71 @@ void MR_Run(unsigned int file_count,
             Reducer reducer, 
             unsigned int num_workers,
             unsigned int num_parts)
+{
+    MR_RunChain(file_count, file_names, mapper, reducer, num_workers,
+                num_parts, NULL, 0);
+}
+
+
+/**
+ * Run a chain of MapReduce jobs, where each stage's reduce outputs are handed
+ * to the next stage's mapper in memory
+ * 
+ * Each stage has its own partitions, so stages overlap: as soon as one of a
+ * stage's reduce jobs finishes, its output partition is sealed and the master
+ * queues a map job for it in the next stage. Only a stage's reduce phase
+ * waits, for all of its own map jobs to finish.
+ * 
+ * @param file_count # of files (i.e. input splits)
+ * @param file_names array of filenames
+ * @param mapper function pointer to the first stage's map function
+ * @param reducer function pointer to the first stage's reduce function
+ * @param num_workers # of threads in the thread pool
+ * @param num_parts # of partitions to be created for the first stage
+ * @param stages array of the downstream stages, in order
+ * @param num_stages # of downstream stages (0 is the same as MR_Run)
+ */
+void MR_RunChain(unsigned int file_count,
+                 char *file_names[],
+                 Mapper mapper,
+                 Reducer reducer,
+                 unsigned int num_workers,
+                 unsigned int num_parts,
+                 MR_Stage_t stages[],
+                 unsigned int num_stages)
 {
     if (num_workers == 0) { printf("No worker threads!\n"); return; }
     if (num_parts == 0) { printf("No partitions\n"); return; }
+    for (unsigned int s = 0; s < num_stages; s++)
+    {
+        if (stages[s].num_parts == 0) { printf("No partitions\n"); return; }
+        if (stages[s].mapper == NULL || stages[s].reducer == NULL)
+        {
+            printf("No mapper or reducer for stages[%u]\n", s);
+            return;
+        }
+    }
 
-    // create the thread pool and partition array
+    // create the thread pool and every stage up front, so that upstream
+    // reducers can hand their outputs straight to a ready downstream stage
     threadpool = ThreadPool_create(num_workers);
-    partitions = malloc(sizeof(partition_t) * num_parts);
-    for (unsigned int i = 0; i < num_parts; i++)
+    unsigned int total_stages = num_stages + 1;
+    stage_t *chain = malloc(sizeof(stage_t) * total_stages);
+    for (unsigned int s = 0; s < total_stages; s++)
     {
-        partitions[i].size = 0;
-        partitions[i].head = NULL;
-        pthread_mutex_init(&partitions[i].lock, NULL);
+        bool first = (s == 0);
+        chain[s].file_mapper = first ? mapper : NULL;
+        chain[s].mapper = first ? NULL : stages[s - 1].mapper;
+        chain[s].reducer = first ? reducer : stages[s - 1].reducer;
+        chain[s].num_partitions = first ? num_parts : stages[s - 1].num_parts;
+        chain[s].next = (s + 1 < total_stages) ? &chain[s + 1] : NULL;
+        // each upstream partition becomes one downstream map job
+        stage_init(&chain[s],
+                   first ? file_count : chain[s - 1].num_partitions,
+                   chain[s].next != NULL);
+        chain[s].inputs = first ? NULL : chain[s - 1].outputs;
     }
-    num_partitions = num_parts;
+    only_stage = (num_stages == 0) ? &chain[0] : NULL;
 
     // sort the input filenames by ascending file size
     char **sorted_file_names = malloc(sizeof(char *) * file_count);
@@ -109,41 +601,237 @@ void MR_Run(unsigned int file_count,
           sizeof(char *),
           (int (*)(const void *, const void *)) compare_mapper_files);
 
-    // run the mapper
+    // run the first stage's mapper (job func is MR_Map)
     for (unsigned int i = 0; i < file_count; i++)
     {
-        ThreadPool_add_job(threadpool,
-                           (void (*)(void *)) mapper,
-                           sorted_file_names[i]);
+        chain[0].map_tasks[i].file_name = sorted_file_names[i];
+        ThreadPool_add_job(threadpool, MR_Map, &chain[0].map_tasks[i]);
+    }
+
+    for (unsigned int s = 0; s < total_stages; s++)
+    {
+        stage_t *stage = &chain[s];
+
+        // wait for this stage's mapper
+        pthread_mutex_lock(&stage->lock);
+        while (stage->pending_maps > 0)
+            pthread_cond_wait(&stage->maps_done, &stage->lock);
+        pthread_mutex_unlock(&stage->lock);
+
+        // sort the reduce jobs by ascending partition size
+        qsort(stage->reduce_tasks,
+              stage->num_partitions,
+              sizeof(task_t),
+              (int (*)(const void *, const void *)) compare_partitions);
+
+        // run 1 reduction job per partition (job func is MR_Reduce)
+        for (unsigned int i = 0; i < stage->num_partitions; i++)
+        {
+            ThreadPool_add_job(threadpool, MR_Reduce,
+                               &stage->reduce_tasks[i]);
+        }
+        if (stage->next == NULL) break;
+
+        // feed the next stage's mapper one partition at a time, as soon as
+        // each is sealed. jobs are only ever queued from the master thread,
+        // since ThreadPool_check can't tell a busy worker from one queueing
+        for (unsigned int i = 0; i < stage->num_partitions; i++)
+        {
+            pthread_mutex_lock(&stage->lock);
+            while (stage->num_sealed <= i)
+                pthread_cond_wait(&stage->part_sealed, &stage->lock);
+            unsigned int sealed_idx = stage->sealed[i];
+            pthread_mutex_unlock(&stage->lock);
+
+            ThreadPool_add_job(threadpool, MR_Map,
+                               &stage->next->map_tasks[sealed_idx]);
+        }
     }
     ThreadPool_check(threadpool);
-    // mapper is done now
+    only_stage = NULL;
     free(sorted_file_names);
 
-    // sort the partition indices by ascending partition size
-    unsigned int *sorted_part_idxs = malloc(sizeof(unsigned int) * num_parts);
-    for (unsigned int i = 0; i < num_parts; i++)
-        sorted_part_idxs[i] = i;
-    qsort(sorted_part_idxs,
-          num_parts,
-          sizeof(unsigned int),
-          (int (*)(const void *, const void *)) compare_partitions);
-
-    // run 1 reduction job per partition (job func is MR_Reduce)
-    global_reducer = reducer;
+    // destroy the threadpool and free memory when done
+    ThreadPool_destroy(threadpool);
+    for (unsigned int s = 0; s < total_stages; s++)
+        stage_destroy(&chain[s]);
+    free(chain);
+}
+
+
+/**
+ * Run the MapReduce framework continuously over growing files or FIFOs
+ * 
+ * The master thread polls every source and queues each batch of complete
+ * lines as a map job. Map outputs are folded straight into per-key state
+ * with the combiner, kept separately for each slide-long pane. Each time a
+ * slide elapses, the panes making up the last window are combined and
+ * handed to the reducer, then the oldest pane is dropped, so memory only
+ * grows with the # of keys seen within one window.
+ * 
+ * @param source_count # of sources
+ * @param source_names array of file or FIFO names
+ * @param mapper function pointer to the map function
+ * @param combiner function pointer to the combine function
+ * @param reducer function pointer to the window reduce function
+ * @param num_workers # of threads in the thread pool
+ * @param num_parts # of partitions to be created
+ * @param config window and polling settings
+ */
+void MR_RunStream(unsigned int source_count,
+                  char *source_names[],
+                  StreamMapper mapper,
+                  Combiner combiner,
+                  WindowReducer reducer,
+                  unsigned int num_workers,
+                  unsigned int num_parts,
+                  MR_StreamConfig_t config)
+{
+    if (num_workers == 0) { printf("No worker threads!\n"); return; }
+    if (num_parts == 0) { printf("No partitions\n"); return; }
+    if (config.slide_ms == 0 || config.window_ms < config.slide_ms
+        || config.window_ms % config.slide_ms != 0)
+    {
+        printf("Window must be a non-zero multiple of the slide\n");
+        return;
+    }
+    if (config.poll_ms == 0) { printf("No poll interval\n"); return; }
+
+    // open every source without blocking, so that an idle FIFO or a file at
+    // its current end doesn't stall the others
+    source_t *sources = malloc(sizeof(source_t) * source_count);
+    for (unsigned int i = 0; i < source_count; i++)
+    {
+        sources[i].name = source_names[i];
+        sources[i].fd = open(source_names[i], O_RDONLY | O_NONBLOCK);
+        sources[i].buf = NULL;
+        sources[i].len = sources[i].cap = 0;
+        sources[i].skipping = false;
+        if (sources[i].fd == -1)
+        {
+            printf("Cannot open %s\n", source_names[i]);
+            for (unsigned int j = 0; j < i; j++)
+                close(sources[j].fd);
+            free(sources);
+            return;
+        }
+    }
+
+    stream_t stream;
+    stream.mapper = mapper;
+    stream.combiner = combiner;
+    stream.reducer = reducer;
+    stream.num_panes = config.window_ms / config.slide_ms;
+    stream.pane = 0;
+    stream.tables = malloc(sizeof(table_t) * num_parts);
     for (unsigned int i = 0; i < num_parts; i++)
     {
-        ThreadPool_add_job(threadpool,
-                           (void (*)(void *)) MR_Reduce,
-                           &sorted_part_idxs[i]);
+        stream.tables[i].num_buckets = STREAM_INIT_BUCKETS;
+        stream.tables[i].buckets = calloc(STREAM_INIT_BUCKETS,
+                                          sizeof(state_t *));
+        stream.tables[i].num_keys = 0;
+        pthread_mutex_init(&stream.tables[i].lock, NULL);
     }
-    ThreadPool_check(threadpool);
-    // reducer is done now
-    free(sorted_part_idxs);
+
+    threadpool = ThreadPool_create(num_workers);
+    stage_t stage;
+    stage.file_mapper = NULL;
+    stage.mapper = NULL;
+    stage.reducer = NULL;
+    stage.num_partitions = num_parts;
+    stage.next = NULL;
+    stage.inputs = NULL;
+    stage_init(&stage, 0, false);
+    stage.stream = &stream;
+    only_stage = &stage;
+
+    // poll the sources, closing a window every slide, until told to stop
+    size_t max_record = config.max_record > 0 ? config.max_record
+                                              : STREAM_MAX_RECORD;
+    stream_stop = 0;
+    unsigned long start = now_ms();
+    unsigned long next_close = start + config.slide_ms;
+    unsigned long last_input = start;
+    while (!stream_stop)
+    {
+        bool got_input = false;
+        for (unsigned int i = 0; i < source_count; i++)
+        {
+            got_input |= stream_poll(&stage, &sources[i], 2 * num_workers,
+                                     max_record);
+        }
+
+        unsigned long now = now_ms();
+        if (got_input)
+            last_input = now;
+        else if (config.idle_ms > 0 && now - last_input >= config.idle_ms)
+            break;
+
+        if (now >= next_close)
+        {
+            stream_close_window(&stage, next_close - start, config.window_ms);
+            next_close += config.slide_ms;
+        }
+        else if (!got_input)
+        {
+            unsigned long wait = next_close - now;
+            if (wait > config.poll_ms) wait = config.poll_ms;
+            struct timespec ts = { wait / 1000, (wait % 1000) * 1000000L };
+            nanosleep(&ts, NULL);
+        }
+    }
+    // a trailing line without a newline is only complete once we stop
+    for (unsigned int i = 0; i < source_count; i++)
+    {
+        if (sources[i].len == 0) continue;
+        sources[i].buf[sources[i].len++] = '\n';
+        stream_submit(&stage, &sources[i], sources[i].len, 2 * num_workers);
+    }
+    // emit whatever has been folded into the last, partial window
+    stream_close_window(&stage, now_ms() - start, config.window_ms);
+    only_stage = NULL;
 
     // destroy the threadpool and free memory when done
     ThreadPool_destroy(threadpool);
-    free(partitions);
+    for (unsigned int i = 0; i < num_parts; i++)
+    {
+        table_t *table = &stream.tables[i];
+        for (unsigned int b = 0; b < table->num_buckets; b++)
+        {
+            state_t *curr = table->buckets[b];
+            while (curr != NULL)
+            {
+                state_t *next = curr->next;
+                for (unsigned int p = 0; p < stream.num_panes; p++)
+                    free(curr->panes[p]);
+                free(curr->panes);
+                free(curr->key);
+                free(curr);
+                curr = next;
+            }
+        }
+        free(table->buckets);
+        pthread_mutex_destroy(&table->lock);
+    }
+    free(stream.tables);
+    stage_destroy(&stage);
+    for (unsigned int i = 0; i < source_count; i++)
+    {
+        if (sources[i].fd != -1) close(sources[i].fd);
+        free(sources[i].buf);
+    }
+    free(sources);
+}
+
+
+/**
+ * Ask a running MR_RunStream to close its last window and return
+ * 
+ * Only sets a flag, so it is safe to call from a signal handler.
+ */
+void MR_StopStream(void)
+{
+    stream_stop = 1;
 }
 
 
@@ -158,17 +846,73 @@ void MR_Run(unsigned int file_count,
  */
 void MR_Emit(char *key, char *value)
 {
+    MR_EmitToken(key, strlen(key), value, strlen(value));
+}
+
+
+/**
+ * Write a map output whose key and value are given as (pointer, length)
+ * views, e.g. tokens straight out of a Tokenizer, so that neither needs to
+ * be null-terminated nor measured again.
+ * 
+ * @param key start of the output key
+ * @param key_len no. bytes in the key
+ * @param value start of the output value
+ * @param value_len no. bytes in the value
+ */
+void MR_EmitToken(const char *key, size_t key_len,
+                  const char *value, size_t value_len)
+{
+    MR_EmitHashed(key, key_len, value, value_len, MR_Hash(key, key_len));
+}
+
+
+/**
+ * Write a map output whose key has already been hashed with MR_Hash,
+ * skipping the partitioner's own pass over the key
+ * 
+ * The copied key and value are null-terminated, and must be freed
+ * alongside the pair.
+ * 
+ * @param key start of the output key
+ * @param key_len no. bytes in the key
+ * @param value start of the output value
+ * @param value_len no. bytes in the value
+ * @param hash MR_Hash(key, key_len)
+ */
+void MR_EmitHashed(const char *key, size_t key_len,
+                   const char *value, size_t value_len,
+                   uint64_t hash)
+{
+    stage_t *stage = caller_stage("MR_Emit");
+    if (stage == NULL) return;
+
+    // copy both strings before entering the critical section
     pair_t *newPair = malloc(sizeof(pair_t));
-    newPair->key = strdup(key);
-    newPair->value = strdup(value);
+    newPair->key = malloc(key_len + 1);
+    memcpy(newPair->key, key, key_len);
+    newPair->key[key_len] = '\0';
+    newPair->value = malloc(value_len + 1);
+    memcpy(newPair->value, value, value_len);
+    newPair->value[value_len] = '\0';
+    newPair->key_len = key_len;
+    newPair->value_len = value_len;
 
-    unsigned int part_idx = MR_Partitioner(key, num_partitions);
+    if (stage->stream != NULL)
+    {
+        // streaming jobs fold the pair into per-key state instead
+        stream_emit(stage, newPair, hash);
+        return;
+    }
+
+    partition_t *partitions = stage->partitions;
+    unsigned int part_idx = hash % stage->num_partitions;
     // to write pair into partition, enter critical section
     pthread_mutex_lock(&partitions[part_idx].lock);
 
     // find where to insert the key for ascending order
     pair_t *prev = NULL, *curr = partitions[part_idx].head;
-    while (curr != NULL && strcmp(key, curr->key) >= 0)    
+    while (curr != NULL && strcmp(newPair->key, curr->key) >= 0)
     {
         // our new key is not yet less than this one, keep traversing
         prev = curr;
@@ -182,18 +926,102 @@ void MR_Emit(char *key, char *value)
         prev->next = newPair;
 
     // increase partition size counter by combined kv size.
-    // add 2 extra bytes for the null terminators not included by strlen
-    partitions[part_idx].size += strlen(key) + strlen(value) + 2;
+    // add 2 extra bytes for the null terminators not included in the lengths
+    partitions[part_idx].size += key_len + value_len + 2;
 
     // end critical section, we're done writing now
     pthread_mutex_unlock(&partitions[part_idx].lock);
 }
 
 
+/**
+ * Hash a key in a single pass, 8 bytes at a time
+ * 
+ * Each step folds a whole word into the state with a rotate, xor and
+ * multiply (as in FxHash), and a final avalanche mixes the high bits back
+ * down so that taking the result modulo a small partition count is uniform.
+ * 
+ * Keys of 128+ bytes are split across 4 independent lanes, one word each per
+ * 32-byte block, so the CPU can overlap the lanes' multiplies instead of
+ * waiting on one chain. The lanes stay in scalar registers: AVX2 has no
+ * 64-bit multiply, and emulating it made a vector version slower. Shorter
+ * keys (most words) take the serial path, where merging the lanes costs
+ * more than it saves.
+ * 
+ * @param key start of the key
+ * @param len no. bytes in the key
+ * 
+ * @return 64-bit hash of the key
+ */
+uint64_t MR_Hash(const char *key, size_t len)
+{
+    const uint64_t seed = 0x51d7348d3c5d1f45ULL;
+    uint64_t hash = len * 0x9e3779b97f4a7c15ULL;
+    uint64_t word;
+    if (len >= 128)
+    {
+        // named lanes rather than an array, so -O2 keeps them in registers
+        uint64_t h0 = hash, h1 = hash ^ seed;
+        uint64_t h2 = hash + seed, h3 = hash - seed;
+        uint64_t w0, w1, w2, w3;
+        while (len >= 32)
+        {
+            memcpy(&w0, key, 8);
+            memcpy(&w1, key + 8, 8);
+            memcpy(&w2, key + 16, 8);
+            memcpy(&w3, key + 24, 8);
+            h0 = (((h0 << 5) | (h0 >> 59)) ^ w0) * seed;
+            h1 = (((h1 << 5) | (h1 >> 59)) ^ w1) * seed;
+            h2 = (((h2 << 5) | (h2 >> 59)) ^ w2) * seed;
+            h3 = (((h3 << 5) | (h3 >> 59)) ^ w3) * seed;
+            key += 32;
+            len -= 32;
+        }
+        // merge the lanes back into the serial state
+        hash = (((h0 << 5) | (h0 >> 59)) ^ h1) * seed;
+        hash = (((hash << 5) | (hash >> 59)) ^ h2) * seed;
+        hash = (((hash << 5) | (hash >> 59)) ^ h3) * seed;
+    }
+    while (len >= 8)
+    {
+        memcpy(&word, key, 8);  // unaligned-safe load, compiles to one mov
+        hash = (((hash << 5) | (hash >> 59)) ^ word) * seed;
+        key += 8;
+        len -= 8;
+    }
+    if (len >= 4)
+    {
+        // 4-7 bytes left: two overlapping 4-byte loads cover them branch-free
+        uint32_t lo, hi;
+        memcpy(&lo, key, 4);
+        memcpy(&hi, key + len - 4, 4);
+        word = ((uint64_t) hi << 32) | lo;
+        hash = (((hash << 5) | (hash >> 59)) ^ word) * seed;
+    }
+    else if (len > 0)
+    {
+        // 1-3 bytes left: first, middle and last byte (some may repeat)
+        word = ((uint64_t) (unsigned char) key[0] << 16)
+             | ((uint64_t) (unsigned char) key[len >> 1] << 8)
+             | (uint64_t) (unsigned char) key[len - 1];
+        hash = (((hash << 5) | (hash >> 59)) ^ word) * seed;
+    }
+
+    // murmur3 finalizer
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdULL;
+    hash ^= hash >> 33;
+    hash *= 0xc4ceb9fe1a85ec53ULL;
+    hash ^= hash >> 33;
+    return hash;
+}
+
+
 /**
  * Hash a mapper's output to determine the partition that will hold it
  * 
- * Using the DJB2 Hash algorithm for this implementation
+ * Uses MR_Hash, so this agrees with the partition chosen by every
+ * MR_Emit variant.
  * 
  * @param key key of a specifc map output
  * @param num_partitions total # of partitions
@@ -202,11 +1030,33 @@ void MR_Emit(char *key, char *value)
  */
 unsigned int MR_Partitioner(char *key, unsigned int num_partitions)
 {
-    unsigned long hash = 5381;
-    int c;
-    while ((c = *key++) != '\0')
-        hash = hash * 33 + c;
-    return hash % num_partitions;
+    return MR_Hash(key, strlen(key)) % num_partitions;
+}
+
+
+/**
+ * Within a thread, run a map job: the file mapper for the first stage, or
+ * the stage mapper over one sealed upstream output partition
+ * 
+ * @param threadarg pointer to the map job's args (task_t)
+ */
+void MR_Map(void *threadarg)
+{
+    task_t *task = (task_t *) threadarg;
+    stage_t *stage = task->stage;
+
+    current_stage = stage;
+    if (stage->file_mapper != NULL)
+        stage->file_mapper(task->file_name);
+    else
+        stage->mapper(task->idx);
+    current_stage = NULL;
+
+    // let the master know once the last map job of this stage is done
+    pthread_mutex_lock(&stage->lock);
+    if (--stage->pending_maps == 0)
+        pthread_cond_signal(&stage->maps_done);
+    pthread_mutex_unlock(&stage->lock);
 }
 
 
@@ -214,19 +1064,202 @@ unsigned int MR_Partitioner(char *key, unsigned int num_partitions)
  * Within a thread, run the reducer callback function for each
  * <key, (list of values)> retrieved from a partition
  * 
- * @param threadarg pointer to the partition index (unsigned int) to reduce
+ * Once the partition is drained its outputs are sealed, and the master is
+ * told so it can queue the matching map job of the downstream stage.
+ * 
+ * @param threadarg pointer to the reduce job's args (task_t)
  */
 void MR_Reduce(void *threadarg)
 {
-    unsigned int partition_idx = *((unsigned int *) threadarg);
+    task_t *task = (task_t *) threadarg;
+    stage_t *stage = task->stage;
+    unsigned int partition_idx = task->idx;
     char *current_key = NULL;
-    while (partitions[partition_idx].head != NULL)
+
+    current_stage = stage;
+    while (stage->partitions[partition_idx].head != NULL)
     {
         // reduce all the keys matching the current head
-        current_key = strdup(partitions[partition_idx].head->key);
-        global_reducer(current_key, partition_idx);
+        current_key = strdup(stage->partitions[partition_idx].head->key);
+        stage->reducer(current_key, partition_idx);
         free(current_key);
     }
+    current_stage = NULL;
+
+    if (stage->next != NULL)
+    {
+        pthread_mutex_lock(&stage->lock);
+        stage->sealed[stage->num_sealed++] = partition_idx;
+        pthread_cond_signal(&stage->part_sealed);
+        pthread_mutex_unlock(&stage->lock);
+    }
+}
+
+
+/**
+ * Within a thread, run the stream mapper on each line of a chunk read from
+ * a source, then free the chunk
+ * 
+ * @param threadarg pointer to the chunk (chunk_t) to map
+ */
+void MR_MapStream(void *threadarg)
+{
+    chunk_t *chunk = (chunk_t *) threadarg;
+    stage_t *stage = chunk->stage;
+
+    current_stage = stage;
+    char *record = chunk->data, *end = chunk->data + chunk->len;
+    while (record < end)
+    {
+        char *newline = memchr(record, '\n', end - record);
+        *newline = '\0';
+        stage->stream->mapper(record);
+        record = newline + 1;
+    }
+    current_stage = NULL;
+    free(chunk->data);
+    free(chunk);
+
+    // let the master know there is room to queue another chunk
+    pthread_mutex_lock(&stage->lock);
+    stage->pending_maps--;
+    pthread_cond_signal(&stage->maps_done);
+    pthread_mutex_unlock(&stage->lock);
+}
+
+
+/**
+ * Within a thread, run the window reducer for each key with state in the
+ * closing window of a partition, then drop the oldest pane
+ * 
+ * Keys left with no state in any pane are evicted.
+ * 
+ * @param threadarg pointer to the reduce job's args (task_t)
+ */
+void MR_ReduceWindow(void *threadarg)
+{
+    task_t *task = (task_t *) threadarg;
+    stream_t *stream = task->stage->stream;
+    table_t *table = &stream->tables[task->idx];
+    unsigned int oldest = (stream->pane + 1) % stream->num_panes;
+
+    for (unsigned int b = 0; b < table->num_buckets; b++)
+    {
+        state_t *prev = NULL, *curr = table->buckets[b];
+        while (curr != NULL)
+        {
+            // combine the window's panes, oldest first
+            char *value = NULL;
+            for (unsigned int k = 0; k < stream->num_panes; k++)
+            {
+                char *pane = curr->panes[(oldest + k) % stream->num_panes];
+                if (pane == NULL) continue;
+                if (value == NULL)
+                {
+                    value = strdup(pane);
+                    continue;
+                }
+                char *combined = stream->combiner(curr->key, value, pane);
+                if (combined != NULL)
+                {
+                    free(value);
+                    value = combined;
+                }
+            }
+            if (value != NULL)
+            {
+                stream->reducer(curr->key, value, stream->window, task->idx);
+                free(value);
+            }
+
+            // the oldest pane is about to be reused for the next slide
+            free(curr->panes[oldest]);
+            curr->panes[oldest] = NULL;
+            bool empty = true;
+            for (unsigned int p = 0; p < stream->num_panes && empty; p++)
+                empty = (curr->panes[p] == NULL);
+
+            state_t *next = curr->next;
+            if (empty)
+            {
+                if (prev == NULL)
+                    table->buckets[b] = next;
+                else
+                    prev->next = next;
+                free(curr->panes);
+                free(curr->key);
+                free(curr);
+                table->num_keys--;
+            }
+            else
+            {
+                prev = curr;
+            }
+            curr = next;
+        }
+    }
+}
+
+
+/**
+ * Write a reduce output, a <key, value> pair, to this partition's output
+ * 
+ * The output partition is only touched by the one reduce job that owns it,
+ * and only read by the downstream mapper after that job ends, so appending
+ * needs no lock. Outputs are dropped if there is no downstream stage.
+ * 
+ * @param key output key
+ * @param value output value
+ * @param partition_idx index of the partition being reduced
+ */
+void MR_EmitOutput(char *key, char *value, unsigned int partition_idx)
+{
+    stage_t *stage = caller_stage("MR_EmitOutput");
+    if (stage == NULL || stage->outputs == NULL) return;
+    output_t *output = &stage->outputs[partition_idx];
+
+    pair_t *newPair = malloc(sizeof(pair_t));
+    newPair->key = strdup(key);
+    newPair->value = strdup(value);
+    newPair->key_len = strlen(key);
+    newPair->value_len = strlen(value);
+    newPair->next = NULL;
+
+    if (output->tail == NULL)
+        output->head = newPair;
+    else
+        output->tail->next = newPair;
+    output->tail = newPair;
+}
+
+
+/**
+ * Get the next <key, value> pair of a sealed upstream output partition,
+ * and pop it out
+ * 
+ * Note: the caller is responsible for freeing the returned key and value.
+ * 
+ * @param input_idx index of the upstream partition this map job reads
+ * @param key output pointer for the key
+ * @param value output pointer for the value
+ * 
+ * @return True if a pair was popped, false once the input is exhausted
+ */
+bool MR_GetInput(unsigned int input_idx, char **key, char **value)
+{
+    stage_t *stage = caller_stage("MR_GetInput");
+    if (stage == NULL || stage->inputs == NULL) return false;
+    output_t *input = &stage->inputs[input_idx];
+    pair_t *curr = input->head;
+    if (curr == NULL) return false;
+
+    input->head = curr->next;
+    if (input->head == NULL)
+        input->tail = NULL;
+    *key = curr->key;
+    *value = curr->value;
+    free(curr);
+    return true;
 }
 
 
@@ -244,6 +1277,9 @@ void MR_Reduce(void *threadarg)
  */
 char *MR_GetNext(char *key, unsigned int partition_idx)
 {
+    stage_t *stage = caller_stage("MR_GetNext");
+    if (stage == NULL) return NULL;
+    partition_t *partitions = stage->partitions;
     // traversing this partition is critical, lock it from writes
     pthread_mutex_lock(&partitions[partition_idx].lock);
 
@@ -270,7 +1306,7 @@ char *MR_GetNext(char *key, unsigned int partition_idx)
     
     // decrease partition size by the total kv size for this pair
     char *value = curr->value;
-    partitions[partition_idx].size -= strlen(key) + strlen(value) + 2;
+    partitions[partition_idx].size -= curr->key_len + curr->value_len + 2;
 
     // free the pair and return the value
     free(curr->key);
@@ -4,9 +4,50 @@
 #ifndef _MAPREDUCE_H
 #define _MAPREDUCE_H
 
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 // function pointer typedefs
 typedef void (*Mapper)(char *file_name);
+typedef void (*StageMapper)(unsigned int input_idx);
 typedef void (*Reducer)(char *key, unsigned int partition_idx);
+typedef void (*StreamMapper)(char *record);
+typedef char *(*Combiner)(char *key, char *state, char *value);
+
+
+typedef struct
+{
+    unsigned long start_ms;     // window start, in ms since the stream began
+    unsigned long end_ms;       // window end (exclusive)
+} MR_Window_t;
+
+typedef void (*WindowReducer)(char *key,
+                              char *value,
+                              MR_Window_t window,
+                              unsigned int partition_idx);
+
+
+typedef struct
+{
+    StageMapper mapper;         // map function, reads via MR_GetInput
+    Reducer reducer;            // reduce function
+    unsigned int num_parts;     // # of partitions to be created
+} MR_Stage_t;
+
+
+typedef struct
+{
+    unsigned long window_ms;    // length of each window
+    unsigned long slide_ms;     // time between windows (= window_ms to tumble)
+    unsigned long poll_ms;      // max sleep between polls when input is idle
+    unsigned long idle_ms;      // stop once idle this long (0 = never)
+    size_t max_record;          // max bytes per record (0 = 1 MiB default)
+} MR_StreamConfig_t;
 
 
 /**
@@ -28,7 +69,81 @@ void MR_Run(unsigned int file_count,
 
 
 /**
- * Write a specifc map output, a <key, value> pair, to a partition
+ * Run a chain of MapReduce jobs. The first stage is set up like MR_Run;
+ * each later stage gets one map job per partition of the stage before it,
+ * reading that partition's reduce outputs (see MR_EmitOutput) from memory.
+ * A downstream map job starts as soon as its input partition is sealed.
+ * 
+ * @param file_count number of files (i.e. input splits)
+ * @param file_names array of filenames
+ * @param mapper function pointer to the first stage's map function
+ * @param reducer function pointer to the first stage's reduce function
+ * @param num_workers # of threads in the thread pool
+ * @param num_parts # of partitions to be created for the first stage
+ * @param stages array of the downstream stages, in order
+ * @param num_stages # of downstream stages (0 is the same as MR_Run)
+ */
+void MR_RunChain(unsigned int file_count,
+                 char *file_names[],
+                 Mapper mapper,
+                 Reducer reducer,
+                 unsigned int num_workers,
+                 unsigned int num_parts,
+                 MR_Stage_t stages[],
+                 unsigned int num_stages);
+
+
+/**
+ * Run the MapReduce framework continuously over growing files or FIFOs.
+ * Each line read is passed to the mapper; its MR_Emit outputs are folded
+ * into per-key state with the combiner, and every slide_ms the combined
+ * state of the last window_ms is passed to the reducer for each key.
+ * Runs until MR_StopStream is called, or the input has been idle for
+ * config.idle_ms. A line longer than config.max_record bytes (excluding its
+ * newline) is dropped with a message rather than passed to the mapper, so a
+ * source without newlines can't buffer without limit. poll_ms must be
+ * non-zero.
+ * 
+ * The combiner must be associative: it folds a value into a key's state
+ * (both strings) and returns the result as a newly allocated string, which
+ * the library takes ownership of, freeing the old state. It must not update
+ * or return state itself, since state is only allocated to fit its current
+ * contents. Returning NULL (e.g. on allocation failure) keeps the old state
+ * and drops the value. It is also used to merge the panes of a sliding
+ * window.
+ * 
+ * @param source_count # of sources
+ * @param source_names array of file or FIFO names
+ * @param mapper function pointer to the map function
+ * @param combiner function pointer to the combine function
+ * @param reducer function pointer to the window reduce function
+ * @param num_workers # of threads in the thread pool
+ * @param num_parts # of partitions to be created
+ * @param config window and polling settings
+ */
+void MR_RunStream(unsigned int source_count,
+                  char *source_names[],
+                  StreamMapper mapper,
+                  Combiner combiner,
+                  WindowReducer reducer,
+                  unsigned int num_workers,
+                  unsigned int num_parts,
+                  MR_StreamConfig_t config);
+
+
+/**
+ * Ask a running MR_RunStream to emit its last window and return.
+ * Safe to call from a signal handler.
+ */
+void MR_StopStream(void);
+
+
+/**
+ * Write a specifc map output, a <key, value> pair, to a partition.
+ * Must be called from a map job, or for MR_Run and MR_RunStream only, from
+ * a thread the mapper spawned; otherwise it prints an error and does
+ * nothing. The same goes for MR_EmitToken, MR_EmitHashed and MR_GetInput,
+ * and for MR_EmitOutput and MR_GetNext from reduce jobs.
  * 
  * @param key output key
  * @param value output value
@@ -36,6 +151,45 @@ void MR_Run(unsigned int file_count,
 void MR_Emit(char *key, char *value);
 
 
+/**
+ * Write a map output given as (pointer, length) views, which need not be
+ * null-terminated (e.g. tokens from a Tokenizer)
+ * 
+ * @param key start of the output key
+ * @param key_len no. bytes in the key
+ * @param value start of the output value
+ * @param value_len no. bytes in the value
+ */
+void MR_EmitToken(const char *key, size_t key_len,
+                  const char *value, size_t value_len);
+
+
+/**
+ * Write a map output whose key was already hashed with MR_Hash
+ * 
+ * @param key start of the output key
+ * @param key_len no. bytes in the key
+ * @param value start of the output value
+ * @param value_len no. bytes in the value
+ * @param hash MR_Hash(key, key_len)
+ */
+void MR_EmitHashed(const char *key, size_t key_len,
+                   const char *value, size_t value_len,
+                   uint64_t hash);
+
+
+/**
+ * Hash a key in a single word-at-a-time pass. The result picks the key's
+ * partition (hash % num_partitions) and may be reused by the caller.
+ * 
+ * @param key start of the key
+ * @param len no. bytes in the key
+ * 
+ * @return 64-bit hash of the key
+ */
+uint64_t MR_Hash(const char *key, size_t len);
+
+
 /**
  * Hash a mapper's output to determine the partition that will hold it
  * 
@@ -47,6 +201,14 @@ void MR_Emit(char *key, char *value);
 unsigned int MR_Partitioner(char *key, unsigned int num_partitions);
 
 
+/**
+ * Run a stage's map function on one of its inputs
+ * 
+ * @param threadarg pointer to a hidden args object
+ */
+void MR_Map(void *threadarg);
+
+
 /**
  * Run the reducer callback function for each <key, (list of values)> 
  * retrieved from a partition
@@ -56,6 +218,46 @@ unsigned int MR_Partitioner(char *key, unsigned int num_partitions);
 void MR_Reduce(void *threadarg);
 
 
+/**
+ * Run the stream mapper on each record of a chunk read from a source
+ * 
+ * @param threadarg pointer to a hidden args object
+ */
+void MR_MapStream(void *threadarg);
+
+
+/**
+ * Run the window reducer for each key with state in the closing window
+ * 
+ * @param threadarg pointer to a hidden args object
+ */
+void MR_ReduceWindow(void *threadarg);
+
+
+/**
+ * Write a reduce output, a <key, value> pair, to be read by the next stage's
+ * mapper. Ignored in the last stage of a chain.
+ * 
+ * @param key output key
+ * @param value output value
+ * @param partition_idx index of the partition being reduced
+ */
+void MR_EmitOutput(char *key, char *value, unsigned int partition_idx);
+
+
+/**
+ * Get the next <key, value> pair output by the previous stage's reducer.
+ * The caller must free both the key and the value.
+ * 
+ * @param input_idx index of the previous stage's partition to read
+ * @param key output pointer for the key
+ * @param value output pointer for the value
+ * 
+ * @return True if a pair was read, false once the input is exhausted
+ */
+bool MR_GetInput(unsigned int input_idx, char **key, char **value);
+
+
 /**
  * Get the next value of the given key in the partition
  * 
@@ -68,4 +270,8 @@ void MR_Reduce(void *threadarg);
 char *MR_GetNext(char *key, unsigned int partition_idx);
 
 
+#ifdef __cplusplus
+}
+#endif
+
 #endif  // _MAPREDUCE_H
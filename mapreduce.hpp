@@ -0,0 +1,514 @@
+// mapreduce.hpp
+// Tawfeeq Mannan
+
+#ifndef _MAPREDUCE_HPP
+#define _MAPREDUCE_HPP
+
+// library includes
+#include <algorithm>    // std::sort
+#include <cstdio>       // printf
+#include <cstddef>      // size_t
+#include <cstdint>      // uint64_t
+#include <functional>   // std::hash
+#include <memory>       // std::unique_ptr
+#include <mutex>        // std::mutex
+#include <string_view>  // std::string_view
+#include <type_traits>  // std::enable_if_t, ...
+#include <unordered_map>
+#include <utility>      // std::pair, std::move
+#include <vector>
+
+// user includes
+#include "mapreduce.h"
+#include "threadpool.h"
+
+
+namespace mr
+{
+
+
+/**
+ * @brief Whether K is a string type, hashed by its characters
+ *
+ * Excludes char pointers: keys are grouped with < and ==, which compare
+ * pointers by address, so hashing their characters would disagree.
+ */
+template <typename K>
+constexpr bool is_string_key_v =
+    std::is_convertible_v<const K &, std::string_view>
+    && !std::is_pointer_v<K>;
+
+
+/**
+ * @brief Whether K has a usable std::hash specialization
+ */
+template <typename K>
+constexpr bool has_std_hash_v =
+    std::is_default_constructible_v<std::hash<K>>;
+
+
+/**
+ * @brief Default key hash
+ *
+ * Picked by key type, in this order:
+ * - strings and string views: MR_Hash over the characters, so a key lands in
+ *   the same partition as it would through MR_Emit
+ * - types with std::hash (integers, ...): std::hash mixed with the murmur3
+ *   finalizer, since std::hash of an integer is usually the integer itself
+ * - PODs with no padding (std::has_unique_object_representations), e.g.
+ *   struct { int a, b; }: MR_Hash over the object's bytes
+ *
+ * Any other key type needs its own hash functor, passed to make_job.
+ */
+template <typename K, typename Enable = void>
+struct Hash;
+
+
+template <typename K>
+struct Hash<K, std::enable_if_t<is_string_key_v<K>>>
+{
+    uint64_t operator()(const K &key) const
+    {
+        std::string_view view = key;
+        return MR_Hash(view.data(), view.size());
+    }
+};
+
+
+template <typename K>
+struct Hash<K, std::enable_if_t<!is_string_key_v<K> && has_std_hash_v<K>>>
+{
+    uint64_t operator()(const K &key) const
+    {
+        uint64_t hash = std::hash<K>{}(key);
+        hash ^= hash >> 33;
+        hash *= 0xff51afd7ed558ccdULL;
+        hash ^= hash >> 33;
+        hash *= 0xc4ceb9fe1a85ec53ULL;
+        hash ^= hash >> 33;
+        return hash;
+    }
+};
+
+
+template <typename K>
+struct Hash<K, std::enable_if_t<!is_string_key_v<K> && !has_std_hash_v<K>
+                                && std::has_unique_object_representations_v<K>>>
+{
+    uint64_t operator()(const K &key) const
+    {
+        // no padding, so equal keys always have equal bytes
+        return MR_Hash(reinterpret_cast<const char *>(&key), sizeof(K));
+    }
+};
+
+
+/**
+ * @brief Placeholder combine function for jobs without a combiner
+ */
+struct NoCombine {};
+
+
+/**
+ * @brief Read-only range over the values of one key in a sorted partition
+ */
+template <typename K, typename V>
+class Values
+{
+public:
+    using pair_t = std::pair<K, V>;
+
+    class iterator
+    {
+    public:
+        explicit iterator(const pair_t *pair) : pair_(pair) {}
+        const V &operator*() const { return pair_->second; }
+        const V *operator->() const { return &pair_->second; }
+        iterator &operator++() { ++pair_; return *this; }
+        bool operator==(const iterator &rhs) const { return pair_ == rhs.pair_; }
+        bool operator!=(const iterator &rhs) const { return pair_ != rhs.pair_; }
+
+    private:
+        const pair_t *pair_;        // pair holding the current value
+    };
+
+    Values(const pair_t *first, const pair_t *last)
+        : first_(first), last_(last) {}
+    iterator begin() const { return iterator(first_); }
+    iterator end() const { return iterator(last_); }
+    size_t size() const { return last_ - first_; }
+
+private:
+    const pair_t *first_;           // first pair with this key
+    const pair_t *last_;            // one past the last pair with this key
+};
+
+
+/**
+ * @brief A typed MapReduce job
+ *
+ * Runs on the same threadpool and MR_Hash partitioning as MR_Run, but keys
+ * and values are stored natively, and since the map, reduce and combine
+ * functions are template parameters they are inlined into the emit and
+ * reduce loops instead of being called through function pointers.
+ *
+ * Map jobs buffer their outputs per partition (or, with a combiner, fold
+ * them per key) without locking, and append them to the shared partitions
+ * once at the end. Each reduce job sorts its partition by key, then calls
+ * the reduce function once per key, in ascending order.
+ *
+ * - map(const Input &input, Emitter &emit), calling emit(key, value)
+ * - reduce(const K &key, const Values<K, V> &values, unsigned int part_idx)
+ * - combine(V &acc, const V &value), folding value into acc (optional)
+ *
+ * K must be hashable by HashFn (see Hash for the defaults) and support <
+ * and ==, so char pointers are rejected. Non-owning keys such as
+ * std::string_view must point into data that outlives run().
+ */
+template <typename K,
+          typename V,
+          typename MapFn,
+          typename ReduceFn,
+          typename CombineFn = NoCombine,
+          typename HashFn = Hash<K>>
+class Job
+{
+    static_assert(!(std::is_pointer_v<K>
+                    && std::is_convertible_v<K, std::string_view>),
+                  "char pointer keys compare by address; use std::string_view");
+
+public:
+    static constexpr bool combines = !std::is_same_v<CombineFn, NoCombine>;
+    using pair_t = std::pair<K, V>;
+
+
+    /**
+     * @brief Per map job output buffer, passed to the map function
+     */
+    class Emitter
+    {
+    public:
+        explicit Emitter(Job &job)
+            : job_(job),
+              buffers_(job.num_parts_),
+              combined_(0, BucketHash{ job.hash_ }) {}
+
+        /**
+         * @brief Write a map output, a <key, value> pair
+         *
+         * @param key output key
+         * @param value output value
+         */
+        void operator()(const K &key, const V &value)
+        {
+            if constexpr (combines)
+            {
+                auto [it, inserted] = combined_.try_emplace(key, value);
+                if (!inserted)
+                    job_.combine_(it->second, value);
+            }
+            else
+            {
+                uint64_t hash = job_.hash_(key);
+                buffers_[hash % job_.num_parts_].emplace_back(key, value);
+            }
+        }
+
+        /**
+         * @brief Append everything buffered to the job's partitions
+         */
+        void flush()
+        {
+            if constexpr (combines)
+            {
+                for (auto &kv : combined_)
+                {
+                    uint64_t hash = job_.hash_(kv.first);
+                    buffers_[hash % job_.num_parts_].emplace_back(
+                        kv.first, std::move(kv.second));
+                }
+                combined_.clear();
+            }
+
+            for (unsigned int i = 0; i < job_.num_parts_; i++)
+            {
+                if (buffers_[i].empty()) continue;
+                Partition &part = job_.partitions_[i];
+                // one critical section per partition per map job
+                std::lock_guard<std::mutex> guard(part.lock);
+                std::vector<pair_t> &buffer = buffers_[i];
+                if (part.pairs.empty())
+                    part.pairs.swap(buffer);
+                else
+                    part.pairs.insert(part.pairs.end(),
+                                      std::make_move_iterator(buffer.begin()),
+                                      std::make_move_iterator(buffer.end()));
+                buffer.clear();
+            }
+        }
+
+    private:
+        // bucket by the high bits, the low bits all pick the same partition
+        struct BucketHash
+        {
+            HashFn hash;            // copy of the job's key hash
+            size_t operator()(const K &key) const { return hash(key) >> 32; }
+        };
+
+        Job &job_;                                  // job being mapped
+        std::vector<std::vector<pair_t>> buffers_;  // outputs per partition
+        std::unordered_map<K, V, BucketHash> combined_;  // folded outputs
+    };
+
+
+    /**
+     * @brief Create a typed job
+     *
+     * @param map map function
+     * @param reduce reduce function
+     * @param combine combine function (NoCombine for none)
+     * @param num_workers # of threads in the thread pool
+     * @param num_parts # of partitions to be created
+     */
+    Job(MapFn map,
+        ReduceFn reduce,
+        CombineFn combine,
+        unsigned int num_workers,
+        unsigned int num_parts)
+        : map_(std::move(map)),
+          reduce_(std::move(reduce)),
+          combine_(std::move(combine)),
+          num_workers_(num_workers),
+          num_parts_(num_parts) {}
+
+
+    /**
+     * @brief Create a typed job with a custom key hash
+     *
+     * @param map map function
+     * @param reduce reduce function
+     * @param combine combine function (NoCombine for none)
+     * @param hash key hash, returning a uint64_t
+     * @param num_workers # of threads in the thread pool
+     * @param num_parts # of partitions to be created
+     */
+    Job(MapFn map,
+        ReduceFn reduce,
+        CombineFn combine,
+        HashFn hash,
+        unsigned int num_workers,
+        unsigned int num_parts)
+        : map_(std::move(map)),
+          reduce_(std::move(reduce)),
+          combine_(std::move(combine)),
+          hash_(std::move(hash)),
+          num_workers_(num_workers),
+          num_parts_(num_parts) {}
+
+
+    /**
+     * @brief Run the job over a set of input splits
+     *
+     * @param inputs input splits, each passed to one map job
+     */
+    template <typename Input>
+    void run(const std::vector<Input> &inputs)
+    {
+        if (num_workers_ == 0) { printf("No worker threads!\n"); return; }
+        if (num_parts_ == 0) { printf("No partitions\n"); return; }
+
+        ThreadPool_t *threadpool = ThreadPool_create(num_workers_);
+        partitions_.reset(new Partition[num_parts_]);
+
+        // run the mapper, shortest inputs first if their size is known
+        std::vector<MapTask<Input>> map_tasks;
+        map_tasks.reserve(inputs.size());
+        for (const Input &input : inputs)
+            map_tasks.push_back({ this, &input });
+        if constexpr (has_size<Input>::value)
+        {
+            std::sort(map_tasks.begin(), map_tasks.end(),
+                      [](const MapTask<Input> &a, const MapTask<Input> &b)
+                      { return a.input->size() < b.input->size(); });
+        }
+        for (MapTask<Input> &task : map_tasks)
+            ThreadPool_add_job(threadpool, &Job::map_job<Input>, &task);
+        ThreadPool_check(threadpool);
+
+        // run 1 reduction job per partition, smallest partitions first
+        std::vector<ReduceTask> reduce_tasks;
+        reduce_tasks.reserve(num_parts_);
+        for (unsigned int i = 0; i < num_parts_; i++)
+            reduce_tasks.push_back({ this, i });
+        std::sort(reduce_tasks.begin(), reduce_tasks.end(),
+                  [this](const ReduceTask &a, const ReduceTask &b)
+                  { return partitions_[a.idx].pairs.size()
+                           < partitions_[b.idx].pairs.size(); });
+        for (ReduceTask &task : reduce_tasks)
+            ThreadPool_add_job(threadpool, &Job::reduce_job, &task);
+        ThreadPool_check(threadpool);
+
+        // destroy the threadpool and free memory when done
+        ThreadPool_destroy(threadpool);
+        partitions_.reset();
+    }
+
+
+private:
+    struct Partition
+    {
+        std::vector<pair_t> pairs;  // unsorted until reduced
+        std::mutex lock;            // lock to protect concurrent appends
+    };
+
+    template <typename Input>
+    struct MapTask
+    {
+        Job *job;                   // job this map job belongs to
+        const Input *input;         // input split to map
+    };
+
+    struct ReduceTask
+    {
+        Job *job;                   // job this reduce job belongs to
+        unsigned int idx;           // partition index to reduce
+    };
+
+    template <typename T, typename = void>
+    struct has_size : std::false_type {};
+    template <typename T>
+    struct has_size<T, std::void_t<decltype(std::declval<const T &>().size())>>
+        : std::true_type {};
+
+
+    /**
+     * @brief Threadpool job: run the map function on one input split
+     *
+     * @param threadarg pointer to the map job's args (MapTask)
+     */
+    template <typename Input>
+    static void map_job(void *threadarg)
+    {
+        MapTask<Input> *task = static_cast<MapTask<Input> *>(threadarg);
+        Emitter emit(*task->job);
+        task->job->map_(*task->input, emit);
+        emit.flush();
+    }
+
+
+    /**
+     * @brief Threadpool job: sort a partition, then reduce each key in it
+     *
+     * @param threadarg pointer to the reduce job's args (ReduceTask)
+     */
+    static void reduce_job(void *threadarg)
+    {
+        ReduceTask *task = static_cast<ReduceTask *>(threadarg);
+        Job &job = *task->job;
+        std::vector<pair_t> &pairs = job.partitions_[task->idx].pairs;
+
+        std::sort(pairs.begin(), pairs.end(),
+                  [](const pair_t &a, const pair_t &b)
+                  { return a.first < b.first; });
+        const pair_t *first = pairs.data(), *end = first + pairs.size();
+        while (first != end)
+        {
+            const pair_t *last = first + 1;
+            while (last != end && last->first == first->first)
+                last++;
+            job.reduce_(first->first, Values<K, V>(first, last), task->idx);
+            first = last;
+        }
+        std::vector<pair_t>().swap(pairs);  // release the memory right away
+    }
+
+
+    MapFn map_;                     // map function
+    ReduceFn reduce_;               // reduce function
+    CombineFn combine_;             // combine function, or NoCombine
+    HashFn hash_;                   // key hash used to pick partitions
+    unsigned int num_workers_;      // # of threads in the thread pool
+    unsigned int num_parts_;        // # of partitions
+    std::unique_ptr<Partition[]> partitions_;   // array of partitions
+};
+
+
+/**
+ * @brief Create a typed job without a combiner
+ *
+ * @param map map function
+ * @param reduce reduce function
+ * @param num_workers # of threads in the thread pool
+ * @param num_parts # of partitions to be created
+ *
+ * @return The job, ready to run
+ */
+template <typename K, typename V, typename MapFn, typename ReduceFn>
+Job<K, V, MapFn, ReduceFn> make_job(MapFn map,
+                                    ReduceFn reduce,
+                                    unsigned int num_workers,
+                                    unsigned int num_parts)
+{
+    return Job<K, V, MapFn, ReduceFn>(std::move(map), std::move(reduce),
+                                      NoCombine(), num_workers, num_parts);
+}
+
+
+/**
+ * @brief Create a typed job with a combiner
+ *
+ * @param map map function
+ * @param reduce reduce function
+ * @param combine combine function
+ * @param num_workers # of threads in the thread pool
+ * @param num_parts # of partitions to be created
+ *
+ * @return The job, ready to run
+ */
+template <typename K, typename V,
+          typename MapFn, typename ReduceFn, typename CombineFn>
+Job<K, V, MapFn, ReduceFn, CombineFn> make_job(MapFn map,
+                                               ReduceFn reduce,
+                                               CombineFn combine,
+                                               unsigned int num_workers,
+                                               unsigned int num_parts)
+{
+    return Job<K, V, MapFn, ReduceFn, CombineFn>(
+        std::move(map), std::move(reduce), std::move(combine),
+        num_workers, num_parts);
+}
+
+
+/**
+ * @brief Create a typed job with a custom key hash
+ *
+ * For key types the default Hash doesn't cover (e.g. structs with padding).
+ * Pass NoCombine() as combine for a job without a combiner.
+ *
+ * @param map map function
+ * @param reduce reduce function
+ * @param combine combine function, or NoCombine()
+ * @param hash key hash, returning a uint64_t
+ * @param num_workers # of threads in the thread pool
+ * @param num_parts # of partitions to be created
+ *
+ * @return The job, ready to run
+ */
+template <typename K, typename V, typename MapFn, typename ReduceFn,
+          typename CombineFn, typename HashFn>
+Job<K, V, MapFn, ReduceFn, CombineFn, HashFn> make_job(MapFn map,
+                                                       ReduceFn reduce,
+                                                       CombineFn combine,
+                                                       HashFn hash,
+                                                       unsigned int num_workers,
+                                                       unsigned int num_parts)
+{
+    return Job<K, V, MapFn, ReduceFn, CombineFn, HashFn>(
+        std::move(map), std::move(reduce), std::move(combine),
+        std::move(hash), num_workers, num_parts);
+}
+
+
+}  // namespace mr
+
+#endif  // _MAPREDUCE_HPP
@@ -0,0 +1,64 @@
+// streamwc.c
+// Tawfeeq Mannan
+
+// library includes
+#define _GNU_SOURCE  // asprintf only defined in glibc
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// user includes
+#include "mapreduce.h"
+#include "tokenizer.h"
+
+
+void Map(char *record)
+{
+    // set up the delimiters once per worker thread, not once per record
+    static _Thread_local Tokenizer_t tk;
+    static _Thread_local bool tk_ready = false;
+    if (!tk_ready)
+        tk_ready = Tokenizer_init(&tk, NULL, 0, " \t\r");
+
+    Token_t token;
+    Tokenizer_reset(&tk, record, strlen(record));
+    while (Tokenizer_next(&tk, &token))
+    {
+        if (token.len > 0)
+            MR_EmitToken(token.start, token.len, "1", 1);
+    }
+}
+
+
+char *Combine(char *key, char *state, char *value)
+{
+    char *sum;
+    if (asprintf(&sum, "%ld", atol(state) + atol(value)) == -1)
+        return NULL;
+    return sum;
+}
+
+
+void Reduce(char *key, char *value, MR_Window_t window,
+            unsigned int partition_idx)
+{
+    printf("[%lu, %lu) %s: %s\n", window.start_ms, window.end_ms, key, value);
+}
+
+
+void Stop(int signum)
+{
+    MR_StopStream();
+}
+
+
+int main(int argc, char *argv[])
+{
+    // count words over the last 10s, every 2s, until interrupted
+    MR_StreamConfig_t config = { 10000, 2000, 50, 0 };
+    signal(SIGINT, Stop);
+    MR_RunStream(argc - 1, &(argv[1]), Map, Combine, Reduce, 5, 10, config);
+    return 0;
+}
@@ -7,6 +7,10 @@
 #include <pthread.h>
 #include <stdbool.h>
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 typedef void (*thread_func_t)(void *arg);
 
 
@@ -104,4 +108,8 @@ void *Thread_run(ThreadPool_t *tp);
 void ThreadPool_check(ThreadPool_t *tp);
 
 
+#ifdef __cplusplus
+}
+#endif
+
 #endif  // _THREADPOOL_H
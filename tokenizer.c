@@ -0,0 +1,192 @@
+// tokenizer.c
+// Tawfeeq Mannan
+
+// library includes
+#include <stddef.h>     // size_t
+#include <stdbool.h>    // true/false
+#include <string.h>     // memset, memcpy, strlen
+
+#if defined(__x86_64__) || defined(__i386__)
+#define TOKENIZER_X86
+#include <immintrin.h>  // SSE4.2 and AVX2 intrinsics
+#endif
+
+// user includes
+#include "tokenizer.h"
+
+
+/**
+ * @brief Find the first delimiter in a range, one byte at a time
+ *
+ * @param tk pointer to the Tokenizer object holding the delimiter set
+ * @param p start of the range to search
+ * @param n no. bytes in the range
+ *
+ * @return Offset of the first delimiter, or n if there is none
+ */
+static size_t scan_scalar(const Tokenizer_t *tk, const char *p, size_t n)
+{
+    size_t i = 0;
+    while (i < n && !tk->is_delim[(unsigned char) p[i]])
+        i++;
+    return i;
+}
+
+
+#ifdef TOKENIZER_X86
+/**
+ * @brief Find the first delimiter in a range, 16 bytes at a time
+ *
+ * Uses the SSE4.2 string compare instruction, which matches every byte of
+ * the block against the whole delimiter set in one go.
+ *
+ * @param tk pointer to the Tokenizer object holding the delimiter set
+ * @param p start of the range to search
+ * @param n no. bytes in the range
+ *
+ * @return Offset of the first delimiter, or n if there is none
+ */
+__attribute__((target("sse4.2")))
+static size_t scan_sse42(const Tokenizer_t *tk, const char *p, size_t n)
+{
+    const __m128i set = _mm_loadu_si128((const __m128i *) tk->delims);
+    const int set_len = (int) tk->num_delims;
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16)
+    {
+        __m128i block = _mm_loadu_si128((const __m128i *) (p + i));
+        int idx = _mm_cmpestri(set, set_len, block, 16,
+                               _SIDD_UBYTE_OPS | _SIDD_CMP_EQUAL_ANY
+                               | _SIDD_LEAST_SIGNIFICANT);
+        if (idx < 16)
+            return i + idx;
+    }
+    // finish off the tail without reading past the end of the buffer
+    return i + scan_scalar(tk, p + i, n - i);
+}
+
+
+/**
+ * @brief Find the first delimiter in a range, 32 bytes at a time
+ *
+ * Compares each block against every delimiter byte and ORs the results,
+ * so it is fastest for small delimiter sets like whitespace.
+ *
+ * @param tk pointer to the Tokenizer object holding the delimiter set
+ * @param p start of the range to search
+ * @param n no. bytes in the range
+ *
+ * @return Offset of the first delimiter, or n if there is none
+ */
+__attribute__((target("avx2")))
+static size_t scan_avx2(const Tokenizer_t *tk, const char *p, size_t n)
+{
+    __m256i set[TOKENIZER_MAX_DELIMS];
+    for (unsigned int d = 0; d < tk->num_delims; d++)
+        set[d] = _mm256_set1_epi8(tk->delims[d]);
+
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32)
+    {
+        __m256i block = _mm256_loadu_si256((const __m256i *) (p + i));
+        __m256i hits = _mm256_setzero_si256();
+        for (unsigned int d = 0; d < tk->num_delims; d++)
+            hits = _mm256_or_si256(hits, _mm256_cmpeq_epi8(block, set[d]));
+        unsigned int mask = (unsigned int) _mm256_movemask_epi8(hits);
+        if (mask != 0)
+            return i + __builtin_ctz(mask);
+    }
+    // finish off the tail without reading past the end of the buffer
+    return i + scan_scalar(tk, p + i, n - i);
+}
+#endif  // TOKENIZER_X86
+
+
+/**
+ * @brief Initialize a Tokenizer over a buffer
+ *
+ * The buffer is never modified and need not be null-terminated.
+ * The fastest delimiter search the CPU supports is picked here, once.
+ *
+ * @param tk pointer to the Tokenizer object
+ * @param buf buffer to split into tokens
+ * @param len no. bytes in the buffer
+ * @param delims null-terminated set of delimiter bytes (at most 16)
+ *
+ * @return True on success, otherwise false
+ */
+bool Tokenizer_init(Tokenizer_t *tk, const char *buf, size_t len,
+                    const char *delims)
+{
+    if (tk == NULL || delims == NULL) return false;
+    if (buf == NULL && len > 0) return false;
+
+    size_t num_delims = strlen(delims);
+    if (num_delims == 0 || num_delims > TOKENIZER_MAX_DELIMS) return false;
+
+    Tokenizer_reset(tk, buf, len);
+    tk->num_delims = num_delims;
+    memset(tk->delims, 0, sizeof(tk->delims));
+    memcpy(tk->delims, delims, num_delims);
+    memset(tk->is_delim, 0, sizeof(tk->is_delim));
+    for (size_t i = 0; i < num_delims; i++)
+        tk->is_delim[(unsigned char) delims[i]] = true;
+
+    tk->scan = scan_scalar;
+#ifdef TOKENIZER_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        tk->scan = scan_avx2;
+    else if (__builtin_cpu_supports("sse4.2"))
+        tk->scan = scan_sse42;
+#endif
+
+    return true;
+}
+
+
+/**
+ * @brief Point an initialized Tokenizer at a new buffer
+ *
+ * @param tk pointer to the Tokenizer object
+ * @param buf buffer to split into tokens
+ * @param len no. bytes in the buffer
+ */
+void Tokenizer_reset(Tokenizer_t *tk, const char *buf, size_t len)
+{
+    if (tk == NULL) return;
+
+    tk->buf = buf;
+    tk->len = len;
+    tk->pos = 0;
+    tk->done = false;
+}
+
+
+/**
+ * @brief Get the next token from the buffer
+ *
+ * Tokens follow strsep semantics: consecutive delimiters yield empty tokens,
+ * and a trailing delimiter yields a final empty token.
+ *
+ * @param tk pointer to the Tokenizer object
+ * @param token output view into the buffer
+ *
+ * @return True if a token was written, false once the buffer is exhausted
+ */
+bool Tokenizer_next(Tokenizer_t *tk, Token_t *token)
+{
+    if (tk == NULL || token == NULL || tk->done) return false;
+
+    const char *start = tk->buf + tk->pos;
+    size_t len = tk->scan(tk, start, tk->len - tk->pos);
+    token->start = start;
+    token->len = len;
+
+    tk->pos += len;
+    if (tk->pos == tk->len)
+        tk->done = true;  // no delimiter left, this was the last token
+    else
+        tk->pos++;  // step over the delimiter that ended this token
+    return true;
+}
@@ -0,0 +1,85 @@
+// tokenizer.h
+// Tawfeeq Mannan
+
+#ifndef _TOKENIZER_H
+#define _TOKENIZER_H
+
+#include <stddef.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define TOKENIZER_MAX_DELIMS 16     // max # of distinct delimiter bytes
+
+
+typedef struct
+{
+    const char *start;              // first byte of the token (not owned)
+    size_t len;                     // no. bytes in the token, no terminator
+} Token_t;
+
+
+typedef struct Tokenizer_t
+{
+    const char *buf;                // buffer being split (not owned)
+    size_t len;                     // total no. bytes in the buffer
+    size_t pos;                     // offset of the next token to yield
+    bool done;                      // flag set once the last token is yielded
+    unsigned int num_delims;        // no. delimiter bytes in use
+    char delims[TOKENIZER_MAX_DELIMS];  // set of delimiter bytes
+    bool is_delim[256];             // lookup table for the scalar scan
+    // delimiter search kernel, picked at init based on the CPU's features
+    size_t (*scan)(const struct Tokenizer_t *tk, const char *p, size_t n);
+} Tokenizer_t;
+
+
+/**
+ * @brief Initialize a Tokenizer over a buffer
+ *
+ * The buffer is never modified and need not be null-terminated.
+ *
+ * @param tk pointer to the Tokenizer object
+ * @param buf buffer to split into tokens
+ * @param len no. bytes in the buffer
+ * @param delims null-terminated set of delimiter bytes (at most 16)
+ *
+ * @return True on success, otherwise false
+ */
+bool Tokenizer_init(Tokenizer_t *tk, const char *buf, size_t len,
+                    const char *delims);
+
+
+/**
+ * @brief Point an initialized Tokenizer at a new buffer
+ *
+ * Keeps the delimiter set and chosen scan kernel, so it is much cheaper than
+ * Tokenizer_init when splitting many lines with the same delimiters.
+ *
+ * @param tk pointer to the Tokenizer object
+ * @param buf buffer to split into tokens
+ * @param len no. bytes in the buffer
+ */
+void Tokenizer_reset(Tokenizer_t *tk, const char *buf, size_t len);
+
+
+/**
+ * @brief Get the next token from the buffer
+ *
+ * Tokens follow strsep semantics: consecutive delimiters yield empty tokens,
+ * and a trailing delimiter yields a final empty token.
+ *
+ * @param tk pointer to the Tokenizer object
+ * @param token output view into the buffer
+ *
+ * @return True if a token was written, false once the buffer is exhausted
+ */
+bool Tokenizer_next(Tokenizer_t *tk, Token_t *token);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // _TOKENIZER_H
@@ -0,0 +1,194 @@
+// typed_bench.cpp
+// Tawfeeq Mannan
+
+// library includes
+#include <atomic>       // std::atomic
+#include <chrono>       // std::chrono::steady_clock
+#include <cstdio>       // printf, fopen, ...
+#include <cstdlib>      // free
+#include <string>       // std::string
+#include <string_view>  // std::string_view
+#include <vector>
+
+// user includes
+#include "mapreduce.hpp"
+#include "tokenizer.h"
+
+#define DELIMS " \t\n\r"
+#define RUN_FILES 2     // MR_Run's sorted inserts are quadratic, keep it short
+
+
+static std::atomic<unsigned long> total_count;   // sum of all word counts
+
+
+/**
+ * @brief Get the current time of the monotonic clock
+ *
+ * @return Time in seconds
+ */
+static double now()
+{
+    using namespace std::chrono;
+    return duration<double>(steady_clock::now().time_since_epoch()).count();
+}
+
+
+/**
+ * @brief Read a whole file into a string
+ *
+ * @param file_name file to read
+ * @param contents output file contents
+ *
+ * @return True on success, otherwise false
+ */
+static bool read_file(const char *file_name, std::string &contents)
+{
+    FILE *fp = fopen(file_name, "r");
+    if (fp == NULL) return false;
+    char buf[65536];
+    size_t n;
+    contents.clear();
+    while ((n = fread(buf, 1, sizeof(buf), fp)) > 0)
+        contents.append(buf, n);
+    fclose(fp);
+    return true;
+}
+
+
+// string-based path: the C API's wordcount, from the same in-memory splits
+static std::vector<std::string> *splits;
+
+void Map_string(char *file_name)
+{
+    const std::string &split = (*splits)[atoi(file_name)];
+    Tokenizer_t tk;
+    Token_t token;
+    Tokenizer_init(&tk, split.data(), split.size(), DELIMS);
+    while (Tokenizer_next(&tk, &token))
+        MR_EmitToken(token.start, token.len, "1", 1);
+}
+
+
+void Reduce_string(char *key, unsigned int partition_idx)
+{
+    unsigned long count = 0;
+    char *value;
+    while ((value = MR_GetNext(key, partition_idx)) != NULL)
+    {
+        count += atoi(value);
+        free(value);
+    }
+    total_count += count;
+}
+
+
+// typed path: string_view keys into the splits, int values
+struct MapTyped
+{
+    template <typename Emitter>
+    void operator()(std::string_view split, Emitter &emit) const
+    {
+        Tokenizer_t tk;
+        Token_t token;
+        Tokenizer_init(&tk, split.data(), split.size(), DELIMS);
+        while (Tokenizer_next(&tk, &token))
+            emit(std::string_view(token.start, token.len), 1);
+    }
+};
+
+
+struct ReduceTyped
+{
+    void operator()(std::string_view key,
+                    const mr::Values<std::string_view, int> &values,
+                    unsigned int partition_idx) const
+    {
+        unsigned long count = 0;
+        for (int value : values)
+            count += value;
+        total_count += count;
+    }
+};
+
+
+struct CombineTyped
+{
+    void operator()(int &acc, int value) const { acc += value; }
+};
+
+
+/**
+ * @brief Time the string-based and typed wordcounts over some splits
+ *
+ * @param inputs in-memory input splits
+ * @param with_string whether to also run the (quadratic) string-based path
+ */
+static void run_all(std::vector<std::string> &inputs, bool with_string)
+{
+    std::vector<std::string_view> views(inputs.begin(), inputs.end());
+    double start;
+
+    if (with_string)
+    {
+        // the C mapper gets each split's index in place of a file name
+        std::vector<std::string> names;
+        std::vector<char *> name_ptrs;
+        for (size_t i = 0; i < inputs.size(); i++)
+            names.push_back(std::to_string(i));
+        for (std::string &name : names)
+            name_ptrs.push_back(&name[0]);
+        splits = &inputs;
+
+        total_count = 0;
+        start = now();
+        MR_Run(name_ptrs.size(), name_ptrs.data(), Map_string, Reduce_string,
+               5, 10);
+        printf("  MR_Run  string         %8.3f s  (%lu words)\n",
+               now() - start, total_count.load());
+    }
+
+    auto typed = mr::make_job<std::string_view, int>(
+        MapTyped(), ReduceTyped(), 5, 10);
+    total_count = 0;
+    start = now();
+    typed.run(views);
+    printf("  mr::Job typed          %8.3f s  (%lu words)\n",
+           now() - start, total_count.load());
+
+    auto combined = mr::make_job<std::string_view, int>(
+        MapTyped(), ReduceTyped(), CombineTyped(), 5, 10);
+    total_count = 0;
+    start = now();
+    combined.run(views);
+    printf("  mr::Job typed+combine  %8.3f s  (%lu words)\n",
+           now() - start, total_count.load());
+}
+
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2)
+    {
+        printf("Usage: %s FILE...\n", argv[0]);
+        return 1;
+    }
+
+    std::vector<std::string> inputs(argc - 1);
+    for (int i = 1; i < argc; i++)
+    {
+        if (!read_file(argv[i], inputs[i - 1]))
+        {
+            printf("Cannot read %s\n", argv[i]);
+            return 1;
+        }
+    }
+
+    std::vector<std::string> few(inputs.begin(),
+                                 inputs.begin() + std::min<size_t>(
+                                     inputs.size(), RUN_FILES));
+    printf("wordcount over %zu file(s)\n", few.size());
+    run_all(few, true);
+    printf("wordcount over %zu file(s)\n", inputs.size());
+    run_all(inputs, false);
+    return 0;
+}